@@ -35,10 +35,13 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <glob.h>
 #include <time.h>
 #include <regex.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <veriuser.h>
 #include <vpi_user.h>
@@ -49,6 +52,14 @@
 
 #define SVLIB_STRING_BUFFER_START_SIZE       (256)
 #define SVLIB_STRING_BUFFER_LONGEST_PATHNAME (8192)
+#define SVLIB_FILE_WRITER_DEFAULT_BUFFER     (256*1024)
+#define SVLIB_GREP_CHUNK_SIZE                (1024*1024)
+#define SVLIB_HASH_MMAP_WINDOW               (64*1024*1024)
+
+/* Diagnostics go straight to stderr: io_printf is a PLI routine and
+ * must not be called from threads that the simulator doesn't know about.
+ */
+#define SVLIB_DIAG(...) fprintf(stderr, __VA_ARGS__)
 
 #ifdef _CPLUSPLUS
 extern "C" {
@@ -56,47 +67,90 @@ extern "C" {
 
 #include "../svlib_shared_c_sv.h"
 
-static char*  libStringBuffer = NULL;
-static size_t libStringBufferSize = 0;
+/*--------------------------------------------------------------------------
+ * FOR INTERNAL USE BY SVLIB ONLY:
+ *--------------------------------------------------------------------------
+ * Every thread has its own string buffer, used to hold string results
+ * until the simulator has copied them on return from the DPI call.
+ * All other state lives in objects whose chandle is held by the caller,
+ * so the DPI functions are safe to call from several threads at once
+ * provided that no two threads share a chandle.
+ */
+typedef struct libStringBuffer {
+  char   * buf;
+  size_t   size;
+} libStringBuffer_s, *libStringBuffer_p;
+
+static pthread_key_t  libStringBufferKey;
+static pthread_once_t libStringBufferOnce = PTHREAD_ONCE_INIT;
+
+static void libStringBufferFree(void *p) {
+  libStringBuffer_p lsb = (libStringBuffer_p)p;
+  free(lsb->buf);
+  free(lsb);
+}
+
+static void libStringBufferKeyCreate(void) {
+  if (pthread_key_create(&libStringBufferKey, libStringBufferFree)) {
+    perror("PROBLEM in SvLib::libStringBufferKeyCreate: cannot create key");
+  }
+}
+
+static libStringBuffer_p getThreadStringBuffer() {
+  libStringBuffer_p lsb;
+  (void) pthread_once(&libStringBufferOnce, libStringBufferKeyCreate);
+  lsb = (libStringBuffer_p)pthread_getspecific(libStringBufferKey);
+  if (lsb == NULL) {
+    lsb = calloc(1, sizeof(libStringBuffer_s));
+    if (lsb == NULL) {
+      perror("PROBLEM in SvLib::getThreadStringBuffer: cannot malloc");
+    } else if (pthread_setspecific(libStringBufferKey, lsb)) {
+      free(lsb);
+      lsb = NULL;
+    }
+  }
+  return lsb;
+}
 
 /*--------------------------------------------------------------------------
  * FOR INTERNAL USE BY SVLIB ONLY:
  *--------------------------------------------------------------------------
- * Get a new string buffer of given size.
- * If size<=0 and there is currently no buffer,
- * create one with the default size. If size=0 and
- * there is already a buffer, return it. If size<0
- * and there is already a buffer, double its existing
- * size and then return it.
+ * Get the calling thread's string buffer, at least of the given size.
+ * If size=0 and there is currently no buffer, create one with the
+ * default size. If size=0 and there is already a buffer, return it.
+ * Returns NULL only if no buffer at all could be allocated.
  */ 
 static char* getLibStringBuffer(size_t size) {
-  if (size<=0) {
-    if (libStringBuffer==NULL) {
-      return getLibStringBuffer(SVLIB_STRING_BUFFER_START_SIZE);
-    } else if (size == 0) {
-      return libStringBuffer;
-    } else {
-      return getLibStringBuffer(2*libStringBufferSize);
+  libStringBuffer_p lsb = getThreadStringBuffer();
+  if (lsb == NULL) {
+    return NULL;
+  }
+  if (size == 0) {
+    if (lsb->buf != NULL) {
+      return lsb->buf;
     }
-  } else if (libStringBufferSize < size) {
+    size = SVLIB_STRING_BUFFER_START_SIZE;
+  }
+  if (lsb->size < size) {
     char* buf = malloc(size);
     if (buf == NULL) {
       /* Report the error and return the existing buffer, whatever it is */
       perror("PROBLEM in SvLib::getLibStringBuffer: cannot malloc");
     } else {
-      free(libStringBuffer);
-      libStringBuffer = buf;
-      libStringBufferSize = size;
+      free(lsb->buf);
+      lsb->buf  = buf;
+      lsb->size = size;
     }
   }
-  return libStringBuffer;
+  return lsb->buf;
 }
 
 static size_t getLibStringBufferSize() {
-  if (libStringBuffer==NULL) {
+  libStringBuffer_p lsb = getThreadStringBuffer();
+  if (lsb == NULL || lsb->buf == NULL) {
     return 0;
   } else {
-    return libStringBufferSize;
+    return lsb->size;
   }
 }
 
@@ -105,90 +159,194 @@ static size_t getLibStringBufferSize() {
  *--------------------------------------------------------------------------
  * Mechanism to retrieve an array of strings from C into SV.
  * A function such as 'glob' whose main result is an array of strings
- * will construct such an array in internal storage here, then return
- * a chandle pointing to the sa_buf_struct that records the array of strings
- * and svlib's progress through collecting them.
- * Subsequent calls to svlib_dpi_imported_saBufNext with this chandle will then
- * serve up the strings one by one, finally returning with the chandle set
- * to null to indicate that all the strings have been consumed and the 
- * C-side internal storage has been freed and is no longer accessible.
+ * will pack the strings, end to end, into a single buffer owned by an
+ * sa_buf_struct, recording the start offset of each one, then return a
+ * chandle pointing to that sa_buf_struct. SV then collects the whole
+ * array in three calls, however many strings there are:
+ *   svlib_dpi_imported_saBufCount   - how many strings
+ *   svlib_dpi_imported_saBufGetAll  - copy them all into an SV string array
+ *   svlib_dpi_imported_saBufFree    - release the C-side storage
+ * The storage cannot be freed by saBufGetAll itself, because the
+ * simulator copies output strings only after the call returns.
+ * svlib_dpi_imported_saBufNext serves up the strings one by one instead,
+ * for tools that cannot handle open arrays of strings, freeing the
+ * storage and setting the chandle to null after the last one.
  */
 
-/* Each different data source will require its own mem-free callback. */
-typedef void (*freeFunc_decl)(saBuf_p);
+/* Releases any app-specific data attached to an saBuf. */
+typedef void (*freeFunc_decl)(void *);
 
 typedef struct saBuf {
-  char        ** scan;         /* pointer to the current array element       */
-  freeFunc_decl  freeFunc;     /* function to call on exhaustion             */
-  void         * pAppData;     /* pointer to app-specific data               */
-  int            userData;     /* general-purpose int, not used by saBufNext */
-  struct saBuf * link;         /* general-purpose link ptr                   */
+  char         * data;         /* the strings, each NUL-terminated           */
+  size_t         dataUsed;
+  size_t         dataSize;
+  size_t       * offsets;      /* start of each string within data           */
+  size_t         count;        /* number of strings                          */
+  size_t         offsetsSize;
+  size_t         next;         /* progress of saBufNext                      */
+  freeFunc_decl  freeFunc;     /* function to release pAppData               */
+  void         * pAppData;     /* pointer to app-specific data, or NULL      */
   struct saBuf * sanity_check; /* pointer-to-self for checking               */
 } saBuf_s, *saBuf_p;
 
-static int32_t saBufCreate(size_t dataBytes, freeFunc_decl ff, saBuf_p *created) {
-  *created = NULL;
-  saBuf_p sa = malloc(sizeof(saBuf_s));
+static int32_t saBufCreate(saBuf_p *created) {
+  saBuf_p sa = calloc(1, sizeof(saBuf_s));
+  *created = sa;
   if (sa == NULL) {
     return ENOMEM;
   }
-  sa->pAppData = malloc(dataBytes);
-  if (sa->pAppData == NULL) {
-    free(sa);
-    return ENOMEM;
-  }
   sa->sanity_check = sa;
-  sa->link         = NULL;
-  sa->freeFunc     = ff;
-  sa->scan         = NULL;
-  sa->userData     = 0;
-  *created         = sa;
   return 0;
 }
 
+static saBuf_p saBufCheck(void *h) {
+  saBuf_p sa = (saBuf_p)h;
+  if (sa == NULL || sa->sanity_check != sa) {
+    return NULL;
+  }
+  return sa;
+}
+
+static void saBufDestroy(saBuf_p sa) {
+  if (sa == NULL) return;
+  if (sa->freeFunc != NULL) {
+    (*(sa->freeFunc))(sa->pAppData);
+  }
+  sa->sanity_check = NULL;
+  free(sa->data);
+  free(sa->offsets);
+  free(sa);
+}
+
+/* Append a copy of n chars of s as the next string */
+static int32_t saBufAppend(saBuf_p sa, const char *s, size_t n) {
+  if (sa->count >= sa->offsetsSize) {
+    size_t   size    = sa->offsetsSize ? 2*sa->offsetsSize : 64;
+    size_t * offsets = realloc(sa->offsets, size * sizeof(size_t));
+    if (offsets == NULL) return ENOMEM;
+    sa->offsets     = offsets;
+    sa->offsetsSize = size;
+  }
+  if (sa->dataUsed + n + 1 > sa->dataSize) {
+    size_t size = sa->dataSize ? 2*sa->dataSize : 4096;
+    char * data;
+    while (size < sa->dataUsed + n + 1) size *= 2;
+    data = realloc(sa->data, size);
+    if (data == NULL) return ENOMEM;
+    sa->data     = data;
+    sa->dataSize = size;
+  }
+  sa->offsets[sa->count++] = sa->dataUsed;
+  memcpy(&(sa->data[sa->dataUsed]), s, n);
+  sa->dataUsed += n;
+  sa->data[sa->dataUsed++] = '\0';
+  return 0;
+}
+
+/*-------------------------------------------------------------------------------
+ * import "DPI-C" function int svlib_dpi_imported_saBufCount(input chandle h);
+ *-------------------------------------------------------------------------------
+ */
+extern int32_t svlib_dpi_imported_saBufCount(void *h) {
+  saBuf_p sa = saBufCheck(h);
+  return (sa == NULL) ? 0 : sa->count;
+}
+
+/*-------------------------------------------------------------------------------
+ * import "DPI-C" function int svlib_dpi_imported_saBufGetAll(
+ *                                  input chandle h, output string ss[]);
+ *-------------------------------------------------------------------------------
+ * Fill ss with as many of the strings as it can hold, in order.
+ */
+extern int32_t svlib_dpi_imported_saBufGetAll(void *h, svOpenArrayHandle ss) {
+  size_t  i;
+  int     lo, hi;
+  saBuf_p sa = saBufCheck(h);
+  if (sa == NULL) {
+    return EINVAL;
+  }
+  if (sa->count == 0 || svSizeOfArray(ss) == 0) {
+    return 0;
+  }
+  if (svDimensions(ss) != 1) {
+    SVLIB_DIAG("svDimensions=%d, should be 1\n", svDimensions(ss));
+    return EINVAL;
+  }
+  lo = svLow(ss, 1);
+  hi = svHigh(ss, 1);
+  for (i=0; i<sa->count && (int)i<=hi-lo; i++) {
+    *(const char**)(svGetArrElemPtr1(ss, lo+i)) = &(sa->data[sa->offsets[i]]);
+  }
+  return 0;
+}
+
+/*-------------------------------------------------------------------------------
+ * import "DPI-C" function void svlib_dpi_imported_saBufFree(inout chandle h);
+ *-------------------------------------------------------------------------------
+ */
+extern void svlib_dpi_imported_saBufFree(void **h) {
+  saBufDestroy(saBufCheck(*h));
+  *h = NULL;
+}
+
 /*-------------------------------------------------------------------------------
  * import "DPI-C" function int svlib_dpi_imported_saBufNext(inout chandle h, output string s);
  *-------------------------------------------------------------------------------
  */
 extern int32_t svlib_dpi_imported_saBufNext(void **h, const char **s) {
+  saBuf_p p;
   *s = NULL;
   if (*h == NULL) {
     return 0;
   }
-  saBuf_p p = (saBuf_p)(*h);
-  if (p->sanity_check != p) {
+  p = saBufCheck(*h);
+  if (p == NULL) {
     return ENOMEM;
   }
-  *s = *(p->scan);
-  p->scan++;
-  if (*s == NULL) {
+  if (p->next < p->count) {
+    *s = &(p->data[p->offsets[p->next++]]);
+  } else {
     *h = NULL;
-    if (p->freeFunc != NULL) {
-      (*(p->freeFunc))(p);
-    }
+    saBufDestroy(p);
   }
   return 0;
 }
 
 
 /*-------------------------------------------------------------------------------
- * import "DPI-C" function chandle svlib_dpi_imported_getVlogInfo(
- *                              output string product, output string version);
+ * import "DPI-C" context function int svlib_dpi_imported_getVlogInfo(
+ *                              output string product, output string version,
+ *                              output chandle hnd);
  *-------------------------------------------------------------------------------
  * Function to set up the results of vpi_get_vlog_info() ready for consumption.
+ * The command-line arguments are returned as an saBuf.
+ *-------------------------------------------------------------------------------
+ * Some parts taken, with small modifications, from Accellera's UVM DPI code.
+ * Accellera's authorship is acknowledged. The functionality is slightly 
+ * different from Accellera's, in that all nested -f response files are
+ * flattened so that all arguments appear as if on a single command line.
+ * This lowest-common-denominator behaviour matches some existing tools.
  *-------------------------------------------------------------------------------
  */
 
-extern void * svlib_dpi_imported_getVlogInfo(
+#define ARGV_STACK_PTR_SIZE 32
+
+extern int32_t svlib_dpi_imported_getVlogInfo(
       char   ** product,
-      char   ** version
+      char   ** version,
+      void   ** h
     ) {
   int             status;
   s_vpi_vlog_info info;
+  saBuf_p         sa;
+  char **         argv_stack[ARGV_STACK_PTR_SIZE];
+  int             argv_stack_ptr = 0; // stack ptr
+  int32_t         err;
   
   /* Ensure result values are zero for easy error handling */
   *version = NULL;
   *product = NULL;
+  *h       = NULL;
   
   status = vpi_get_vlog_info(&info);
   if (!status) { /*1=ok, 0=fail*/
@@ -197,39 +355,20 @@ extern void * svlib_dpi_imported_getVlogInfo(
      * This is unlikely, but there's nothing we can do about it.
      * Just report it.
      */
-    return NULL;
+    return ENOTSUP;
   }
   *version = info.version;
   *product = info.product;
-  return (void*) info.argv;  
-}
-
-#define ARGV_STACK_PTR_SIZE 32
-
-/*-------------------------------------------------------------------------------
- * import "DPI-C" function string svlib_dpi_imported_getVlogInfoNext(inout chandle hnd);
- *-------------------------------------------------------------------------------
- * Function to get successive strings from already-setup vlog_info
- *-------------------------------------------------------------------------------
- * Some parts taken, with small modifications, from Accellera's UVM DPI code.
- * Accellera's authorship is acknowledged. The functionality is slightly 
- * different from Accellera's, in that all nested -f response files are
- * flattened so that all arguments appear as if on a single command line.
- * This lowest-common-denominator behaviour matches some existing tools.
- *-------------------------------------------------------------------------------
- */
-
-extern const char * svlib_dpi_imported_getVlogInfoNext (void** info_argv) {
-  static char*** argv_stack = NULL;
-  static int argv_stack_ptr = 0; // stack ptr
-
-  if(argv_stack == NULL)
-  {
-    argv_stack = (char***) malloc (sizeof(char**)*ARGV_STACK_PTR_SIZE);
-    argv_stack[0] = (char**)*info_argv;
+  if (info.argv == NULL) {
+    return 0;
+  }
+  err = saBufCreate(&sa);
+  if (err) {
+    return err;
   }
 
-  // until we have returned a value
+  argv_stack[0] = info.argv;
+  // until we have flattened everything
   while (1)
   {
     // at end of current array?, pop stack
@@ -238,12 +377,7 @@ extern const char * svlib_dpi_imported_getVlogInfoNext (void** info_argv) {
       // stack empty?
       if (argv_stack_ptr == 0)
       {
-        // reset stack for next time
-        argv_stack = NULL;
-        argv_stack_ptr = 0;
-        // return completion
-        *info_argv = NULL;
-        return NULL;
+        break;
       }
       // pop stack
       --argv_stack_ptr;
@@ -269,13 +403,19 @@ extern const char * svlib_dpi_imported_getVlogInfoNext (void** info_argv) {
       }
       else
       {      
-        // return current and move to next
+        // collect current and move to next
         char *r = *argv_stack[argv_stack_ptr];
         ++argv_stack[argv_stack_ptr];
-        return r;
+        err = saBufAppend(sa, r, strlen(r));
+        if (err) {
+          saBufDestroy(sa);
+          return err;
+        }
       }
     }
   }
+  *h = (void*) sa;
+  return 0;
 }
 
 
@@ -284,14 +424,47 @@ extern const char * svlib_dpi_imported_getVlogInfoNext (void** info_argv) {
  *-------------------------------------------------------------------
  */
 extern const char* svlib_dpi_imported_getCErrStr(int32_t errnum) {
-  return strerror(errnum);
+
+  size_t  bSize = SVLIB_STRING_BUFFER_START_SIZE;
+  char  * buf;
+  int     err;
+
+  /* strerror() is not thread-safe, so use strerror_r() into our own buffer */
+  while (1) {
+    buf   = getLibStringBuffer(bSize);
+    bSize = getLibStringBufferSize();
+    if (buf == NULL) {
+      return "svlib cannot allocate memory for error string";
+    }
+#if defined(__GLIBC__) && defined(_GNU_SOURCE)
+    /* GNU strerror_r (the default for C++) may return a static string
+     * without touching buf, and truncates rather than failing */
+    {
+      const char *msg = strerror_r(errnum, buf, bSize);
+      if (msg != buf) {
+        strncpy(buf, msg, bSize-1);
+        buf[bSize-1] = 0;
+      }
+      err = 0;
+    }
+#else
+    err = strerror_r(errnum, buf, bSize);
+    if (err == -1) {
+      err = errno;
+    }
+#endif
+    if (err != ERANGE || bSize >= SVLIB_STRING_BUFFER_LONGEST_PATHNAME) {
+      return buf;
+    }
+    bSize *= 2;
+  }
 }
 
 /*----------------------------------------------------------------
  * import "DPI-C" function int svlib_dpi_imported_getcwd(output string result);
  *----------------------------------------------------------------
  */
-extern int32_t svlib_dpi_imported_getcwd(char ** p_result) {
+extern int32_t svlib_dpi_imported_getcwd(const char ** p_result) {
 
   size_t  bSize = SVLIB_STRING_BUFFER_START_SIZE;
   char  * buf;
@@ -299,6 +472,10 @@ extern int32_t svlib_dpi_imported_getcwd(char ** p_result) {
   while (1) {
     buf   = getLibStringBuffer(bSize);
     bSize = getLibStringBufferSize();
+    if (buf == NULL) {
+      *p_result = "";
+      return ENOMEM;
+    }
     if (NULL != getcwd(buf, bSize)) {
       *p_result = buf;
       return 0;
@@ -311,8 +488,9 @@ extern int32_t svlib_dpi_imported_getcwd(char ** p_result) {
         bSize *= 2;
       }
     } else {
-      *p_result = strerror(errno);
-      return errno;
+      int err = errno;
+      *p_result = svlib_dpi_imported_getCErrStr(err);
+      return err;
     }
   }
 }
@@ -388,6 +566,10 @@ extern int32_t svlib_dpi_imported_timeFormat(int64_t epochSeconds, const char *f
   while (1) {
     buf   = getLibStringBuffer(bSize);
     bSize = getLibStringBufferSize();
+    if (buf == NULL) {
+      *formatted = "";
+      return ENOMEM;
+    }
     if (0 != strftime(buf, bSize, format, &timeParts)) {
       *formatted = buf;
       return 0;
@@ -414,6 +596,10 @@ extern int32_t svlib_dpi_imported_timeFormatST(int64_t epochSeconds, const char
   while (1) {
     buf    = getLibStringBuffer(bSize);
     bSize  = getLibStringBufferSize();
+    if (buf == NULL) {
+      *timeST = "";
+      return ENOMEM;
+    }
     nChars = snprintf(buf, bSize, "Stardate %2d%03d.%01d",
                (timeParts.tm_year - 46),
                (((timeParts.tm_yday) * 1000) /
@@ -439,43 +625,43 @@ extern int32_t svlib_dpi_imported_timeFormatST(int64_t epochSeconds, const char
  *                            output int     count );
  *----------------------------------------------------------------
  */
-static void glob_freeFunc(saBuf_p p) {
-  if (p==NULL) return;
-  globfree((glob_t*)(p->pAppData));
-  free(p);
-}
-
 extern int32_t svlib_dpi_imported_globStart(const char *pattern, void **h, uint32_t *number) {
   int32_t result;
+  size_t  i;
+  glob_t  g;
   saBuf_p sa;
   *number = 0;
   *h = NULL;
-  result = saBufCreate(sizeof(glob_t), glob_freeFunc, &sa);
-  if (result) {
-    return result;
-  }
-  result = glob(pattern, GLOB_ERR | GLOB_MARK, NULL, sa->pAppData);
+  result = glob(pattern, GLOB_ERR | GLOB_MARK, NULL, &g);
   switch (result) {
     case GLOB_NOSPACE:
-      glob_freeFunc(sa);
-      return ENOMEM;
+      result = ENOMEM;
+      break;
     case GLOB_ABORTED:
-      glob_freeFunc(sa);
-      return EACCES;
+      result = EACCES;
+      break;
     case GLOB_NOMATCH:
-      *number  = 0;
-      *h       = NULL;
-      glob_freeFunc(sa);
-      return 0;
+      result = 0;
+      break;
     case 0:
-      sa->scan = ((glob_t*)(sa->pAppData))->gl_pathv;
-      *number  = ((glob_t*)(sa->pAppData))->gl_pathc;
-      *h = (void*) sa;
-      return 0;
+      /* Pack the results into an saBuf and release glob's own storage */
+      result = saBufCreate(&sa);
+      for (i=0; i<g.gl_pathc && !result; i++) {
+        result = saBufAppend(sa, g.gl_pathv[i], strlen(g.gl_pathv[i]));
+      }
+      if (result) {
+        saBufDestroy(sa);
+      } else {
+        *number = sa->count;
+        *h      = (void*) sa;
+      }
+      break;
     default:
-      glob_freeFunc(sa);
-      return ENOTSUP;
+      result = ENOTSUP;
+      break;
   }
+  globfree(&g);
+  return result;
 }
 
 typedef struct stat s_stat, *p_stat;
@@ -550,6 +736,7 @@ extern const char* svlib_dpi_imported_regexErrorString(int32_t err, const char*
     do {
       buf = getLibStringBuffer(actSize);
       bSize = getLibStringBufferSize();
+      if (buf == NULL) break;
       actSize = regerror(err, &compiled, buf, bSize);
       /* But resize buffer to fit if required. */
     } while (actSize > bSize);
@@ -611,7 +798,7 @@ extern uint32_t svlib_dpi_imported_regexRun(
   ) {
   uint32_t result;
   regex_t    compiled;
-  regmatch_t * matches;
+  regmatch_t * matches = NULL;
   uint32_t numMatches;
   uint32_t i;
   uint32_t cflags;
@@ -621,13 +808,13 @@ extern uint32_t svlib_dpi_imported_regexRun(
   
   /* result array checks */
   if (svDimensions(matchList) != 1) {
-    io_printf("svDimensions=%d, should be 1\n", svDimensions(matchList));
+    SVLIB_DIAG("svDimensions=%d, should be 1\n", svDimensions(matchList));
     return -1;
   }
   numMatches = svSizeOfArray(matchList) / sizeof(uint32_t);
   if (numMatches != 0) {
     if ((numMatches % 2) != 0) {
-      io_printf("Odd number of elements in matchList\n");
+      SVLIB_DIAG("Odd number of elements in matchList\n");
       return -1;
     }
     numMatches /= 2;
@@ -636,15 +823,18 @@ extern uint32_t svlib_dpi_imported_regexRun(
      * is not a problem because the open array is always supplied
      * by a calling routine that is fully under the library's control.
      * if (svIncrement(matchList,1)>0) {
-     *   io_printf("Descending subscripts in array!\n");
+     *   SVLIB_DIAG("Descending subscripts in array!\n");
      *   return -1;
      * }
      */
     if (svLeft(matchList, 1) != 0) {
-      io_printf("svLeft=%d, should be 0\n", svLeft(matchList,1));
+      SVLIB_DIAG("svLeft=%d, should be 0\n", svLeft(matchList,1));
       return -1;
     }
     matches = malloc(numMatches * sizeof(regmatch_t));
+    if (matches == NULL) {
+      return ENOMEM;
+    }
   }
   
   cflags = REG_EXTENDED;
@@ -653,6 +843,7 @@ extern uint32_t svlib_dpi_imported_regexRun(
   result = regcomp(&compiled, re, cflags);
   if (result) {
     regfree(&compiled);
+    free(matches);
     return result;
   }
   
@@ -675,11 +866,249 @@ extern uint32_t svlib_dpi_imported_regexRun(
     *matchCount = 0;
   }
   regfree(&compiled);
-  if (numMatches) free(matches);
+  free(matches);
   return result;
 }
 
 
+/*----------------------------------------------------------------
+ * FOR INTERNAL USE BY SVLIB ONLY:
+ *----------------------------------------------------------------
+ * Results of a whole-file regex scan. The strings are returned
+ * in an saBuf: for each hit, the line (without its newline)
+ * followed by one string per capture group. The line numbers
+ * are attached to the saBuf as app data, and are fetched
+ * separately by regexGrepLineNums.
+ */
+typedef struct grepLineNums {
+  int32_t  * lineNums;
+  size_t     nHits;
+  size_t     capHits;
+} grepLineNums_s, *grepLineNums_p;
+
+static void grep_freeFunc(void *p) {
+  grepLineNums_p g = (grepLineNums_p)p;
+  if (g==NULL) return;
+  free(g->lineNums);
+  free(g);
+}
+
+static int32_t grepAddLineNum(grepLineNums_p g, int32_t lineNum) {
+  if (g->nHits >= g->capHits) {
+    size_t    cap  = g->capHits ? 2*g->capHits : 64;
+    int32_t * nums = realloc(g->lineNums, cap * sizeof(int32_t));
+    if (nums == NULL) return ENOMEM;
+    g->lineNums = nums;
+    g->capHits  = cap;
+  }
+  g->lineNums[g->nHits++] = lineNum;
+  return 0;
+}
+
+/*----------------------------------------------------------------
+ *   import "DPI-C" function int svlib_dpi_imported_regexGrepFile(
+ *                            input  string  path,
+ *                            input  string  re,
+ *                            input  int     options,
+ *                            input  int     maxHits,
+ *                            input  int     countOnly,
+ *                            output int     reErr,
+ *                            output chandle hnd,
+ *                            output int     hits,
+ *                            output int     nGroups);
+ *----------------------------------------------------------------
+ * Scan a whole file line by line, testing each line against the
+ * regex. Returns an errno value for file problems; a bad regex is
+ * reported through reErr instead. The file is read in large blocks
+ * and the lines are matched in place, so only the hits are copied.
+ * maxHits<=0 means no limit. If countOnly is set, nothing is
+ * collected and hnd is null.
+ */
+extern int32_t svlib_dpi_imported_regexGrepFile(
+    const char *path,
+    const char *re,
+    int32_t     options,
+    int32_t     maxHits,
+    int32_t     countOnly,
+    int32_t    *reErr,
+    void      **h,
+    int32_t    *hits,
+    int32_t    *nGroups
+  ) {
+  regex_t      compiled;
+  regmatch_t * matches  = NULL;
+  size_t       nMatches;
+  int          cflags;
+  int          invert   = (options & regexINVERT) != 0;
+  int          groups   = !countOnly && !invert;  /* captures wanted? */
+  int          fd;
+  char       * buf      = NULL;
+  size_t       bufSize  = SVLIB_GREP_CHUNK_SIZE;
+  size_t       have     = 0;
+  int          eof      = 0;
+  int          stop     = 0;
+  int32_t      lineNum  = 0;
+  int32_t      err      = 0;
+  saBuf_p        sa     = NULL;
+  grepLineNums_p g      = NULL;
+  size_t       i;
+
+  *h       = NULL;
+  *hits    = 0;
+  *nGroups = 0;
+
+  cflags = REG_EXTENDED;
+  if (options & regexNOCASE) cflags |= REG_ICASE;
+  /* Without captures, regexec can stop at the first match it finds
+   * rather than searching for the longest one */
+  if (!groups) cflags |= REG_NOSUB;
+  *reErr = regcomp(&compiled, re, cflags);
+  if (*reErr) {
+    regfree(&compiled);
+    return 0;
+  }
+  nMatches = groups ? compiled.re_nsub + 1 : 0;
+  if (!invert) {
+    *nGroups = compiled.re_nsub;
+  }
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    err = errno;
+    regfree(&compiled);
+    return err;
+  }
+
+  buf = malloc(bufSize+1);
+  if (nMatches > 0) {
+    matches = malloc(nMatches * sizeof(regmatch_t));
+  }
+  if (buf == NULL || (nMatches > 0 && matches == NULL)) {
+    err = ENOMEM;
+    goto done;
+  }
+  if (!countOnly) {
+    err = saBufCreate(&sa);
+    if (err) goto done;
+    g = calloc(1, sizeof(grepLineNums_s));
+    if (g == NULL) {
+      err = ENOMEM;
+      goto done;
+    }
+    sa->pAppData = g;
+    sa->freeFunc = grep_freeFunc;
+  }
+
+  while (!stop) {
+    size_t start = 0;
+    if (!eof) {
+      ssize_t n = read(fd, &buf[have], bufSize-have);
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        err = errno;
+        break;
+      }
+      eof   = (n == 0);
+      have += n;
+    }
+    /* Match every complete line, and the unterminated last line at EOF */
+    while (!stop) {
+      char * line = &buf[start];
+      char * nl   = memchr(line, '\n', have-start);
+      size_t len;
+      int    hit;
+      if (nl != NULL) {
+        *nl = '\0';
+        len = nl - line;
+      } else if (eof && start < have) {
+        buf[have] = '\0';
+        len = have - start;
+      } else {
+        stop = eof;
+        break;
+      }
+      start += len + 1;
+      if (start > have) start = have;
+      lineNum++;
+      hit = (regexec(&compiled, line, nMatches, matches, 0) == 0);
+      if (hit != invert) {
+        (*hits)++;
+        if (g != NULL) {
+          err = grepAddLineNum(g, lineNum);
+          if (!err) err = saBufAppend(sa, line, len);
+          for (i=1; i<nMatches && !err; i++) {
+            if (matches[i].rm_so < 0) {
+              err = saBufAppend(sa, "", 0);
+            } else {
+              err = saBufAppend(sa, &line[matches[i].rm_so],
+                                  matches[i].rm_eo - matches[i].rm_so);
+            }
+          }
+          if (err) goto done;
+        }
+        if (maxHits > 0 && *hits >= maxHits) {
+          stop = 1;
+        }
+      }
+    }
+    /* Keep any partial line, and make room for it to grow if need be */
+    memmove(buf, &buf[start], have-start);
+    have -= start;
+    if (have == bufSize) {
+      char * bigger = realloc(buf, 2*bufSize+1);
+      if (bigger == NULL) {
+        err = ENOMEM;
+        break;
+      }
+      buf      = bigger;
+      bufSize *= 2;
+    }
+  }
+
+done:
+  close(fd);
+  regfree(&compiled);
+  free(matches);
+  free(buf);
+  if (err) {
+    saBufDestroy(sa);
+    *hits = 0;
+    return err;
+  }
+  if (sa != NULL) {
+    if (sa->count == 0) {
+      saBufDestroy(sa);
+    } else {
+      *h = (void*) sa;
+    }
+  }
+  return 0;
+}
+
+/*----------------------------------------------------------------
+ *   import "DPI-C" function int svlib_dpi_imported_regexGrepLineNums(
+ *                            input  chandle hnd,
+ *                            output int     lineNums[]);
+ *----------------------------------------------------------------
+ * Copy the line numbers of the hits into an SV array. The handle
+ * remains valid, ready for its strings to be collected.
+ */
+extern int32_t svlib_dpi_imported_regexGrepLineNums(void *h, svOpenArrayHandle lineNums) {
+  saBuf_p        p = saBufCheck(h);
+  grepLineNums_p g;
+  int            i, lo, hi;
+  if (p == NULL || p->freeFunc != grep_freeFunc) {
+    return EINVAL;
+  }
+  g  = (grepLineNums_p)(p->pAppData);
+  lo = svLow(lineNums, 1);
+  hi = svHigh(lineNums, 1);
+  for (i=lo; i<=hi && (size_t)(i-lo)<g->nHits; i++) {
+    *(int32_t*)(svGetArrElemPtr1(lineNums, i)) = g->lineNums[i-lo];
+  }
+  return 0;
+}
+
 /*----------------------------------------------------------------
  * import "DPI-C" function int svlib_dpi_imported_access(
  *              input string path, input int mode, output int ok);
@@ -706,6 +1135,630 @@ extern int32_t svlib_dpi_imported_access(char *path, int mode, int *ok) {
 
 }
 
+/*----------------------------------------------------------------
+ * import "DPI-C" function int svlib_dpi_imported_pathNormalize(
+ *              input string path, output string result);
+ *----------------------------------------------------------------
+ * Lexical normalization: collapse duplicate separators, remove
+ * "." components and resolve ".." against the preceding component.
+ * ".." at the root of an absolute path is discarded; leading ".."
+ * components of a relative path are kept. An empty relative
+ * result is rendered as ".".
+ */
+extern int32_t svlib_dpi_imported_pathNormalize(const char *path, const char **result) {
+  size_t      len  = strlen(path);
+  int         abs  = (path[0] == '/');
+  size_t      base = abs ? 1 : 0;  /* never pop back beyond here */
+  size_t      o    = base;
+  const char *p    = path;
+  char       *out;
+
+  out = getLibStringBuffer(len+2);
+  if (getLibStringBufferSize() < len+2) {
+    *result = "";
+    return ENOMEM;
+  }
+  if (abs) out[0] = '/';
+
+  while (*p) {
+    const char *comp;
+    size_t      n;
+    while (*p == '/') p++;
+    comp = p;
+    while (*p && *p != '/') p++;
+    n = p - comp;
+    if (n == 0 || (n == 1 && comp[0] == '.')) {
+      continue;
+    }
+    if (n == 2 && comp[0] == '.' && comp[1] == '.') {
+      /* Can we pop a preceding component that isn't itself ".."? */
+      int lastIsDotDot = (o >= base+2) && (out[o-1] == '.') && (out[o-2] == '.')
+                         && ((o == base+2) || (out[o-3] == '/'));
+      if (o > base && !lastIsDotDot) {
+        while (o > base && out[o-1] != '/') o--;
+        if (o > base) o--;
+        continue;
+      }
+      if (abs) {
+        continue;
+      }
+    }
+    if (o > base) out[o++] = '/';
+    memcpy(&out[o], comp, n);
+    o += n;
+  }
+
+  if (o == 0) out[o++] = '.';
+  out[o] = '\0';
+  *result = out;
+  return 0;
+}
+
+/*----------------------------------------------------------------
+ * import "DPI-C" function int svlib_dpi_imported_realpath(
+ *              input string path, output string result);
+ *----------------------------------------------------------------
+ */
+extern int32_t svlib_dpi_imported_realpath(const char *path, const char **result) {
+  char  * resolved;
+  size_t  len;
+  char  * buf;
+
+  *result = "";
+  resolved = realpath(path, NULL);
+  if (resolved == NULL) {
+    return errno;
+  }
+  len = strlen(resolved);
+  buf = getLibStringBuffer(len+1);
+  if (getLibStringBufferSize() < len+1) {
+    free(resolved);
+    return ENOMEM;
+  }
+  memcpy(buf, resolved, len+1);
+  free(resolved);
+  *result = buf;
+  return 0;
+}
+
+/*--------------------------------------------------------------------------
+ * FOR INTERNAL USE BY SVLIB ONLY:
+ *--------------------------------------------------------------------------
+ * Buffered file writer. Output is collected in a C-side buffer and
+ * handed to the OS in large blocks, so that writing a line costs
+ * one DPI call and no system call. For atomic replacement the data
+ * goes to a temporary file alongside the target, which is renamed
+ * over the target when the writer is closed.
+ */
+typedef struct fileWriter {
+  int                 fd;
+  int                 flushPolicy;
+  char              * buf;
+  size_t              size;         /* capacity of buf                   */
+  size_t              used;         /* bytes waiting in buf              */
+  char              * path;         /* final destination                 */
+  char              * tmpPath;      /* temp file if atomic, else NULL    */
+  struct fileWriter * sanity_check; /* pointer-to-self for checking      */
+} fileWriter_s, *fileWriter_p;
+
+static fileWriter_p fwCheck(void *h) {
+  fileWriter_p w = (fileWriter_p)h;
+  if (w == NULL || w->sanity_check != w) {
+    return NULL;
+  }
+  return w;
+}
+
+static int32_t fwWriteAll(int fd, const char *s, size_t n) {
+  while (n > 0) {
+    ssize_t done = write(fd, s, n);
+    if (done < 0) {
+      if (errno == EINTR) continue;
+      return errno;
+    }
+    s += done;
+    n -= done;
+  }
+  return 0;
+}
+
+static int32_t fwDrain(fileWriter_p w) {
+  int32_t err = fwWriteAll(w->fd, w->buf, w->used);
+  w->used = 0;
+  return err;
+}
+
+static int32_t fwPut(fileWriter_p w, const char *s, size_t n) {
+  int32_t err;
+  if (n > w->size - w->used) {
+    err = fwDrain(w);
+    if (err) return err;
+    if (n >= w->size) {
+      /* Too big to be worth buffering */
+      return fwWriteAll(w->fd, s, n);
+    }
+  }
+  memcpy(&(w->buf[w->used]), s, n);
+  w->used += n;
+  return 0;
+}
+
+static void fwFree(fileWriter_p w) {
+  w->sanity_check = NULL;
+  free(w->buf);
+  free(w->path);
+  free(w->tmpPath);
+  free(w);
+}
+
+/*----------------------------------------------------------------
+ * import "DPI-C" function int svlib_dpi_imported_fwOpen(
+ *                            input  string  path,
+ *                            input  int     options,
+ *                            input  int     bufSize,
+ *                            output chandle hnd);
+ *----------------------------------------------------------------
+ */
+extern int32_t svlib_dpi_imported_fwOpen(const char *path, int32_t options, int32_t bufSize, void **h) {
+  fileWriter_p w;
+  int          flags;
+  const char * target;
+  int32_t      err;
+
+  *h = NULL;
+  if ((options & fwAPPEND) && (options & fwATOMIC)) {
+    return EINVAL;
+  }
+  w = calloc(1, sizeof(fileWriter_s));
+  if (w == NULL) {
+    return ENOMEM;
+  }
+  w->fd          = -1;
+  w->flushPolicy = fwFLUSH_FULL;
+  w->size        = (bufSize > 0) ? bufSize : SVLIB_FILE_WRITER_DEFAULT_BUFFER;
+  w->buf         = malloc(w->size);
+  w->path        = strdup(path);
+  if (w->buf == NULL || w->path == NULL) {
+    fwFree(w);
+    return ENOMEM;
+  }
+
+  if (options & fwATOMIC) {
+    /* Unique while this writer exists; O_EXCL catches any clash */
+    size_t len = strlen(path) + 64;
+    w->tmpPath = malloc(len);
+    if (w->tmpPath == NULL) {
+      fwFree(w);
+      return ENOMEM;
+    }
+    snprintf(w->tmpPath, len, "%s.svlib-tmp.%ld.%lx",
+             path, (long)getpid(), (unsigned long)w);
+    target = w->tmpPath;
+    flags  = O_WRONLY | O_CREAT | O_EXCL;
+  } else {
+    target = path;
+    flags  = O_WRONLY | O_CREAT | ((options & fwAPPEND) ? O_APPEND : O_TRUNC);
+  }
+
+  w->fd = open(target, flags, 0666);
+  if (w->fd < 0) {
+    err = errno;
+    fwFree(w);
+    return err;
+  }
+  w->sanity_check = w;
+  *h = (void*) w;
+  return 0;
+}
+
+/*----------------------------------------------------------------
+ * import "DPI-C" function int svlib_dpi_imported_fwSetFlushPolicy(
+ *                            input  chandle hnd,
+ *                            input  int     policy);
+ *----------------------------------------------------------------
+ */
+extern int32_t svlib_dpi_imported_fwSetFlushPolicy(void *h, int32_t policy) {
+  fileWriter_p w = fwCheck(h);
+  if (w == NULL) {
+    return EBADF;
+  }
+  w->flushPolicy = policy;
+  return (policy == fwFLUSH_ALWAYS) ? fwDrain(w) : 0;
+}
+
+/*----------------------------------------------------------------
+ * import "DPI-C" function int svlib_dpi_imported_fwWrite(
+ *                            input  chandle hnd,
+ *                            input  string  s,
+ *                            input  int     newline);
+ *----------------------------------------------------------------
+ */
+extern int32_t svlib_dpi_imported_fwWrite(void *h, const char *s, int32_t newline) {
+  int32_t      err;
+  fileWriter_p w = fwCheck(h);
+  if (w == NULL) {
+    return EBADF;
+  }
+  err = fwPut(w, s, strlen(s));
+  if (!err && newline) {
+    err = fwPut(w, "\n", 1);
+  }
+  if (!err && (w->flushPolicy == fwFLUSH_ALWAYS ||
+               (newline && w->flushPolicy == fwFLUSH_LINE))) {
+    err = fwDrain(w);
+  }
+  return err;
+}
+
+/*----------------------------------------------------------------
+ * import "DPI-C" function int svlib_dpi_imported_fwWriteQS(
+ *                            input  chandle hnd,
+ *                            input  string  lines[]);
+ *----------------------------------------------------------------
+ * Writes every string in the array, each followed by a newline.
+ */
+extern int32_t svlib_dpi_imported_fwWriteQS(void *h, svOpenArrayHandle lines) {
+  int32_t      err = 0;
+  int          i, lo, hi;
+  fileWriter_p w = fwCheck(h);
+  if (w == NULL) {
+    return EBADF;
+  }
+  if (svSizeOfArray(lines) == 0) {
+    return 0;
+  }
+  if (svDimensions(lines) != 1) {
+    SVLIB_DIAG("svDimensions=%d, should be 1\n", svDimensions(lines));
+    return EINVAL;
+  }
+  lo = svLow(lines, 1);
+  hi = svHigh(lines, 1);
+  for (i = lo; i <= hi && !err; i++) {
+    const char *s = *(const char **)svGetArrElemPtr1(lines, i);
+    if (s != NULL) {
+      err = fwPut(w, s, strlen(s));
+    }
+    if (!err) {
+      err = fwPut(w, "\n", 1);
+    }
+  }
+  if (!err && w->flushPolicy != fwFLUSH_FULL) {
+    err = fwDrain(w);
+  }
+  return err;
+}
+
+/*----------------------------------------------------------------
+ * import "DPI-C" function int svlib_dpi_imported_fwFlush(
+ *                            input  chandle hnd);
+ *----------------------------------------------------------------
+ */
+extern int32_t svlib_dpi_imported_fwFlush(void *h) {
+  fileWriter_p w = fwCheck(h);
+  if (w == NULL) {
+    return EBADF;
+  }
+  return fwDrain(w);
+}
+
+/*----------------------------------------------------------------
+ * import "DPI-C" function int svlib_dpi_imported_fwClose(
+ *                            inout  chandle hnd,
+ *                            input  int     commit);
+ *----------------------------------------------------------------
+ * Flushes and closes the file, and frees the writer. For an atomic
+ * writer the temporary file is renamed over the target if ~commit~
+ * is set and all went well, otherwise it is removed.
+ */
+extern int32_t svlib_dpi_imported_fwClose(void **h, int32_t commit) {
+  int32_t      err;
+  fileWriter_p w = fwCheck(*h);
+  if (w == NULL) {
+    return EBADF;
+  }
+  *h  = NULL;
+  err = fwDrain(w);
+  if (close(w->fd) && !err) {
+    err = errno;
+  }
+  if (w->tmpPath != NULL) {
+    if (commit && !err) {
+      if (rename(w->tmpPath, w->path)) {
+        err = errno;
+        (void) unlink(w->tmpPath);
+      }
+    } else {
+      (void) unlink(w->tmpPath);
+    }
+  }
+  fwFree(w);
+  return err;
+}
+
+/*--------------------------------------------------------------------------
+ * FOR INTERNAL USE BY SVLIB ONLY:
+ *--------------------------------------------------------------------------
+ * Streaming implementation of XXH64, a fast non-cryptographic 64-bit hash
+ * (see https://github.com/Cyan4973/xxHash). Input is read as little-endian
+ * regardless of host, so hash values are the same on every platform and
+ * match other XXH64 implementations, which makes them usable as
+ * persistent cache keys.
+ */
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+typedef struct xxh64State {
+  uint64_t total;    /* bytes consumed so far           */
+  uint64_t v[4];     /* the four accumulator lanes      */
+  uint8_t  mem[32];  /* partial stripe awaiting input   */
+  size_t   memSize;
+} xxh64State_s, *xxh64State_p;
+
+static uint64_t xxhRotl64(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t xxhRead64(const uint8_t *p) {
+  return  (uint64_t)p[0]        | ((uint64_t)p[1] <<  8) |
+         ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24) |
+         ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) |
+         ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+}
+
+static uint64_t xxhRead32(const uint8_t *p) {
+  return  (uint64_t)p[0]        | ((uint64_t)p[1] <<  8) |
+         ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24);
+}
+
+static uint64_t xxhRound(uint64_t acc, uint64_t input) {
+  acc += input * XXH_PRIME64_2;
+  acc  = xxhRotl64(acc, 31);
+  return acc * XXH_PRIME64_1;
+}
+
+static uint64_t xxhMergeRound(uint64_t acc, uint64_t val) {
+  acc ^= xxhRound(0, val);
+  return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+static void xxh64Reset(xxh64State_p st, uint64_t seed) {
+  memset(st, 0, sizeof(xxh64State_s));
+  st->v[0] = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+  st->v[1] = seed + XXH_PRIME64_2;
+  st->v[2] = seed;
+  st->v[3] = seed - XXH_PRIME64_1;
+}
+
+static void xxh64Stripe(xxh64State_p st, const uint8_t *p) {
+  st->v[0] = xxhRound(st->v[0], xxhRead64(p));
+  st->v[1] = xxhRound(st->v[1], xxhRead64(p+8));
+  st->v[2] = xxhRound(st->v[2], xxhRead64(p+16));
+  st->v[3] = xxhRound(st->v[3], xxhRead64(p+24));
+}
+
+static void xxh64Update(xxh64State_p st, const void *data, size_t len) {
+  const uint8_t *p = (const uint8_t *)data;
+  st->total += len;
+  if (st->memSize + len < 32) {
+    memcpy(&(st->mem[st->memSize]), p, len);
+    st->memSize += len;
+    return;
+  }
+  if (st->memSize) {
+    size_t fill = 32 - st->memSize;
+    memcpy(&(st->mem[st->memSize]), p, fill);
+    xxh64Stripe(st, st->mem);
+    p   += fill;
+    len -= fill;
+    st->memSize = 0;
+  }
+  while (len >= 32) {
+    xxh64Stripe(st, p);
+    p   += 32;
+    len -= 32;
+  }
+  memcpy(st->mem, p, len);
+  st->memSize = len;
+}
+
+static uint64_t xxh64Digest(const xxh64State_s *st) {
+  const uint8_t *p   = st->mem;
+  size_t         len = st->memSize;
+  uint64_t       h;
+  if (st->total >= 32) {
+    h = xxhRotl64(st->v[0], 1)  + xxhRotl64(st->v[1], 7) +
+        xxhRotl64(st->v[2], 12) + xxhRotl64(st->v[3], 18);
+    h = xxhMergeRound(h, st->v[0]);
+    h = xxhMergeRound(h, st->v[1]);
+    h = xxhMergeRound(h, st->v[2]);
+    h = xxhMergeRound(h, st->v[3]);
+  } else {
+    h = st->v[2] /* the seed */ + XXH_PRIME64_5;
+  }
+  h += st->total;
+  while (len >= 8) {
+    h ^= xxhRound(0, xxhRead64(p));
+    h  = xxhRotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    p += 8; len -= 8;
+  }
+  if (len >= 4) {
+    h ^= xxhRead32(p) * XXH_PRIME64_1;
+    h  = xxhRotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+    p += 4; len -= 4;
+  }
+  while (len > 0) {
+    h ^= (*p) * XXH_PRIME64_5;
+    h  = xxhRotl64(h, 11) * XXH_PRIME64_1;
+    p++; len--;
+  }
+  h ^= h >> 33;
+  h *= XXH_PRIME64_2;
+  h ^= h >> 29;
+  h *= XXH_PRIME64_3;
+  h ^= h >> 32;
+  return h;
+}
+
+/*----------------------------------------------------------------
+ * import "DPI-C" function longint svlib_dpi_imported_hashString(
+ *                            input  string  s,
+ *                            input  longint seed);
+ *----------------------------------------------------------------
+ */
+extern int64_t svlib_dpi_imported_hashString(const char *s, int64_t seed) {
+  xxh64State_s st;
+  xxh64Reset(&st, (uint64_t)seed);
+  xxh64Update(&st, s, strlen(s));
+  return (int64_t)xxh64Digest(&st);
+}
+
+/* Add one string of a sequence to a hash. Each string is
+ * preceded by its length as 8 little-endian bytes, so that
+ * {"ab","c"} and {"a","bc"} hash differently.
+ */
+static void xxh64UpdateToken(xxh64State_p st, const char *s) {
+  uint64_t len = (s == NULL) ? 0 : strlen(s);
+  uint8_t  lenBytes[8];
+  int      b;
+  for (b = 0; b < 8; b++) {
+    lenBytes[b] = (uint8_t)(len >> (8*b));
+  }
+  xxh64Update(st, lenBytes, 8);
+  xxh64Update(st, s, len);
+}
+
+/*----------------------------------------------------------------
+ * import "DPI-C" function longint svlib_dpi_imported_hashQS(
+ *                            input  string  ss[],
+ *                            input  longint seed);
+ *----------------------------------------------------------------
+ * Hash a whole array of strings in one call.
+ */
+extern int64_t svlib_dpi_imported_hashQS(svOpenArrayHandle ss, int64_t seed) {
+  xxh64State_s st;
+  int          i, lo, hi;
+  xxh64Reset(&st, (uint64_t)seed);
+  if (svSizeOfArray(ss) != 0) {
+    lo = svLow(ss, 1);
+    hi = svHigh(ss, 1);
+    for (i = lo; i <= hi; i++) {
+      xxh64UpdateToken(&st, *(const char **)svGetArrElemPtr1(ss, i));
+    }
+  }
+  return (int64_t)xxh64Digest(&st);
+}
+
+/*----------------------------------------------------------------
+ * import "DPI-C" function chandle svlib_dpi_imported_hashStart(
+ *                            input  longint seed);
+ * import "DPI-C" function void    svlib_dpi_imported_hashAddToken(
+ *                            input  chandle hnd,
+ *                            input  string  s);
+ * import "DPI-C" function longint svlib_dpi_imported_hashFinish(
+ *                            inout  chandle hnd);
+ *----------------------------------------------------------------
+ * The same hash as hashQS, built up one string per call, for
+ * tools that cannot pass an open array of strings. hashFinish
+ * releases the state and sets the chandle to null.
+ */
+extern void* svlib_dpi_imported_hashStart(int64_t seed) {
+  xxh64State_p st = malloc(sizeof(xxh64State_s));
+  if (st != NULL) {
+    xxh64Reset(st, (uint64_t)seed);
+  }
+  return (void*)st;
+}
+
+extern void svlib_dpi_imported_hashAddToken(void *h, const char *s) {
+  if (h != NULL) {
+    xxh64UpdateToken((xxh64State_p)h, s);
+  }
+}
+
+extern int64_t svlib_dpi_imported_hashFinish(void **h) {
+  int64_t hash = 0;
+  if (*h != NULL) {
+    hash = (int64_t)xxh64Digest((xxh64State_p)*h);
+    free(*h);
+    *h = NULL;
+  }
+  return hash;
+}
+
+/*----------------------------------------------------------------
+ * import "DPI-C" function int svlib_dpi_imported_hashFile(
+ *                            input  string  path,
+ *                            input  longint seed,
+ *                            output longint hash);
+ *----------------------------------------------------------------
+ * Hash the contents of a file. Regular files are mapped into memory
+ * a window at a time; anything that can't be mapped (a pipe, say)
+ * is read instead.
+ */
+extern int32_t svlib_dpi_imported_hashFile(const char *path, int64_t seed, int64_t *hash) {
+  xxh64State_s st;
+  s_stat       s;
+  int          fd;
+  int32_t      err = 0;
+  off_t        pos = 0;
+
+  *hash = 0;
+  xxh64Reset(&st, (uint64_t)seed);
+  fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return errno;
+  }
+  if (fstat(fd, &s)) {
+    err = errno;
+    close(fd);
+    return err;
+  }
+
+  if (S_ISREG(s.st_mode)) {
+    while (pos < s.st_size) {
+      size_t len = s.st_size - pos;
+      void * map;
+      if (len > SVLIB_HASH_MMAP_WINDOW) len = SVLIB_HASH_MMAP_WINDOW;
+      map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, pos);
+      if (map == MAP_FAILED) {
+        break;  /* carry on below with read() */
+      }
+      (void) posix_madvise(map, len, POSIX_MADV_SEQUENTIAL);
+      xxh64Update(&st, map, len);
+      munmap(map, len);
+      pos += len;
+    }
+  }
+
+  if (pos < s.st_size || !S_ISREG(s.st_mode)) {
+    char    buf[65536];
+    ssize_t n;
+    if (lseek(fd, pos, SEEK_SET) < 0 && S_ISREG(s.st_mode)) {
+      err = errno;
+    }
+    while (!err) {
+      n = read(fd, buf, sizeof(buf));
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        err = errno;
+      } else if (n == 0) {
+        break;
+      } else {
+        xxh64Update(&st, buf, n);
+      }
+    }
+  }
+
+  close(fd);
+  if (!err) {
+    *hash = (int64_t)xxh64Digest(&st);
+  }
+  return err;
+}
+
 
 #ifdef _CPLUSPLUS
 }
@@ -66,7 +66,8 @@ typedef enum {
  */
 typedef enum {
   regexNOCASE  = 1,
-  regexNOLINE  = 2
+  regexNOLINE  = 2,
+  regexINVERT  = 4   /* file grep only: select non-matching lines */
 } REGEX_OPTIONS_ENUM;
 
 /*  ACCESS_MODE_ENUM
@@ -79,3 +80,21 @@ typedef enum {
   accessWRITE  = 2,
   accessEXEC   = 1
 } ACCESS_MODE_ENUM;
+
+/*  FILE_WRITER_OPTIONS_ENUM
+ *  Bitmap of options for opening a FileWriter.
+ *  With neither option the file is created or truncated.
+ */
+typedef enum {
+  fwAPPEND = 1,  /* add to the end of any existing file               */
+  fwATOMIC = 2   /* write to a temp file, rename over target on close */
+} FILE_WRITER_OPTIONS_ENUM;
+
+/*  FILE_WRITER_FLUSH_ENUM
+ *  When a FileWriter passes its buffered data to the OS.
+ */
+typedef enum {
+  fwFLUSH_FULL,   /* only when the buffer fills, or on flush/close */
+  fwFLUSH_LINE,   /* at the end of every line-writing call         */
+  fwFLUSH_ALWAYS  /* at the end of every write call                */
+} FILE_WRITER_FLUSH_ENUM;
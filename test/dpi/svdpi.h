@@ -0,0 +1,27 @@
+/* Minimal stand-in for the simulator's svdpi.h, enough to build
+ * svlib_dpi.c outside a simulator for svlib_dpi_mt_test.c.
+ * An open array is a testOpenArray_s with ascending range [lo:hi].
+ */
+#ifndef SVDPI_H_STUB
+#define SVDPI_H_STUB
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef void *svOpenArrayHandle;
+
+typedef struct testOpenArray {
+  void   * data;
+  int      lo, hi;
+  size_t   elemSize;
+} testOpenArray_s;
+
+extern int   svDimensions   (const svOpenArrayHandle h);
+extern int   svLeft         (const svOpenArrayHandle h, int d);
+extern int   svLow          (const svOpenArrayHandle h, int d);
+extern int   svHigh         (const svOpenArrayHandle h, int d);
+extern int   svIncrement    (const svOpenArrayHandle h, int d);
+extern int   svSizeOfArray  (const svOpenArrayHandle h);
+extern void *svGetArrElemPtr1(const svOpenArrayHandle h, int indx1);
+
+#endif /* SVDPI_H_STUB */
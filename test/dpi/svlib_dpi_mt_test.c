@@ -0,0 +1,344 @@
+/*=============================================================================
+ *  @brief Multi-threaded stress test for the svlib DPI layer
+ * =============================================================================
+ *
+ *                      svlib SystemVerilog Utilities Library
+ *
+ * @File: svlib_dpi_mt_test.c
+ *
+ * Copyright 2014 Verilab, Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ * =============================================================================
+ *
+ * Calls the DPI functions from many threads at once, with inputs that
+ * differ between threads, and checks every result. Builds against the
+ * stand-in simulator headers in this directory. From the repository root:
+ *
+ *   cc -g -fsanitize=thread -I test/dpi src/dpi/svlib_dpi.c test/dpi/svlib_dpi_mt_test.c -lpthread -o svlib_dpi_mt_test && ./svlib_dpi_mt_test
+ *
+ * Exits with status 0 if all results were correct.
+=============================================================================*/
+
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <veriuser.h>
+#include <vpi_user.h>
+#include <svdpi.h>
+
+#include "../../src/svlib_shared_c_sv.h"
+
+#define N_THREADS   16
+#define N_ITERS     4000
+#define N_FILES     50
+#define GLOB_EVERY  32
+#define MAX_PATH    8192
+
+/*--------------------------------------------------------------------------
+ * The DPI functions under test
+ *--------------------------------------------------------------------------
+ */
+extern const char* svlib_dpi_imported_getCErrStr(int32_t errnum);
+extern int32_t     svlib_dpi_imported_getcwd(const char **result);
+extern int32_t     svlib_dpi_imported_timeFormat(int64_t epochSeconds, const char *format, const char **formatted);
+extern int32_t     svlib_dpi_imported_timeFormatST(int64_t epochSeconds, const char **timeST);
+extern int32_t     svlib_dpi_imported_pathNormalize(const char *path, const char **result);
+extern const char* svlib_dpi_imported_regexErrorString(int32_t err, const char *re);
+extern uint32_t    svlib_dpi_imported_regexRun(const char *re, const char *str, int32_t options,
+                                               int32_t startPos, int32_t *matchCount,
+                                               svOpenArrayHandle matchList);
+extern int32_t     svlib_dpi_imported_globStart(const char *pattern, void **h, uint32_t *number);
+extern int32_t     svlib_dpi_imported_getVlogInfo(char **product, char **version, void **h);
+extern int32_t     svlib_dpi_imported_saBufCount(void *h);
+extern int32_t     svlib_dpi_imported_saBufGetAll(void *h, svOpenArrayHandle ss);
+extern void        svlib_dpi_imported_saBufFree(void **h);
+extern int32_t     svlib_dpi_imported_saBufNext(void **h, const char **s);
+
+/*--------------------------------------------------------------------------
+ * Simulator stand-ins
+ *--------------------------------------------------------------------------
+ */
+static char *testArgvSub[] = { "args.f", "+sub1", "+sub2", NULL };
+static char *testArgv[]    = { "sim", "+a", "-f", (char*)testArgvSub, "+b", NULL };
+static const char *testArgsFlat[] = { "sim", "+a", "+sub1", "+sub2", "+b" };
+#define N_ARGS ((int)(sizeof(testArgsFlat)/sizeof(testArgsFlat[0])))
+
+PLI_INT32 vpi_get_vlog_info(p_vpi_vlog_info info) {
+  info->argc    = 5;
+  info->argv    = testArgv;
+  info->product = "stub";
+  info->version = "1.0";
+  return 1;
+}
+
+void io_printf(char *fmt, ...) {
+  (void) fmt;
+}
+
+int svDimensions(const svOpenArrayHandle h) {
+  (void) h;
+  return 1;
+}
+int svLeft(const svOpenArrayHandle h, int d) {
+  (void) d;
+  return ((testOpenArray_s*)h)->lo;
+}
+int svLow(const svOpenArrayHandle h, int d) {
+  (void) d;
+  return ((testOpenArray_s*)h)->lo;
+}
+int svHigh(const svOpenArrayHandle h, int d) {
+  (void) d;
+  return ((testOpenArray_s*)h)->hi;
+}
+int svIncrement(const svOpenArrayHandle h, int d) {
+  (void) h; (void) d;
+  return -1;
+}
+int svSizeOfArray(const svOpenArrayHandle h) {
+  testOpenArray_s *a = (testOpenArray_s*)h;
+  return (a->hi - a->lo + 1) * a->elemSize;
+}
+void *svGetArrElemPtr1(const svOpenArrayHandle h, int indx1) {
+  testOpenArray_s *a = (testOpenArray_s*)h;
+  return (char*)(a->data) + (indx1 - a->lo) * a->elemSize;
+}
+
+/*--------------------------------------------------------------------------
+ * Expected results, computed single-threaded before the workers start
+ *--------------------------------------------------------------------------
+ */
+static const int testErrnos[] = { ENOENT, EACCES, EINVAL, ENOMEM, ERANGE, EEXIST, ENOTDIR };
+#define N_ERRNOS ((int)(sizeof(testErrnos)/sizeof(testErrnos[0])))
+
+static char    expErrStr[N_ERRNOS][256];
+static char    expCwd[MAX_PATH];
+static char    expBadReStr[256];
+static int32_t badReErr;
+static char    expStardate[N_THREADS][64];
+static char    globDir[64];
+static char    globPattern[80];
+static char    globFiles[N_FILES][80];
+
+static int64_t threadEpoch(int id) {
+  return 1400000000LL + id * 3333333LL;
+}
+
+#define CHECK(cond, ...) do {                     \
+    if (!(cond)) {                                \
+      fprintf(stderr, "thread %d: ", id);         \
+      fprintf(stderr, __VA_ARGS__);               \
+      fprintf(stderr, "\n");                      \
+      fails++;                                    \
+    }                                             \
+  } while (0)
+
+/*--------------------------------------------------------------------------
+ * Worker: each iteration exercises every function once, with inputs
+ * that differ from thread to thread and from call to call, so that a
+ * buffer shared between threads shows up as a wrong result.
+ *--------------------------------------------------------------------------
+ */
+static void *worker(void *arg) {
+  int         id    = (int)(intptr_t)arg;
+  long        fails = 0;
+  int         i, k;
+  char        path[MAX_PATH];
+  char        exp[MAX_PATH];
+  char        subject[64];
+  const char *s;
+  int32_t     err;
+
+  for (i = 0; i < N_ITERS && fails < 10; i++) {
+
+    /* pathNormalize, with lengths that make the string buffer grow */
+    {
+      int reps = i % 300;
+      size_t n = 0, m = 0;
+      for (k = 0; k < reps; k++) {
+        n += sprintf(path+n, "d%d//./x/../", id);
+        m += sprintf(exp+m, "%sd%d", k ? "/" : "", id);
+      }
+      n += sprintf(path+n, "f%d.%d", id, i);
+      sprintf(exp+m, "%sf%d.%d", reps ? "/" : "", id, i);
+      err = svlib_dpi_imported_pathNormalize(path, &s);
+      CHECK(err == 0 && strcmp(s, exp) == 0, "pathNormalize gave \"%.40s\"", s);
+    }
+
+    err = svlib_dpi_imported_getcwd(&s);
+    CHECK(err == 0 && strcmp(s, expCwd) == 0, "getcwd gave \"%s\"", s);
+
+    {
+      int64_t   t = threadEpoch(id) + i * 61;
+      time_t    tt = (time_t)t;
+      struct tm parts;
+      char      fmt[64];
+      sprintf(fmt, "%%Y-%%m-%%d %%H:%%M:%%S [%d/%d]", id, i);
+      localtime_r(&tt, &parts);
+      strftime(exp, sizeof(exp), fmt, &parts);
+      err = svlib_dpi_imported_timeFormat(t, fmt, &s);
+      CHECK(err == 0 && strcmp(s, exp) == 0, "timeFormat gave \"%s\"", s);
+    }
+
+    err = svlib_dpi_imported_timeFormatST(threadEpoch(id), &s);
+    CHECK(err == 0 && strcmp(s, expStardate[id]) == 0, "timeFormatST gave \"%s\"", s);
+
+    k = (id + i) % N_ERRNOS;
+    s = svlib_dpi_imported_getCErrStr(testErrnos[k]);
+    CHECK(strcmp(s, expErrStr[k]) == 0, "getCErrStr(%d) gave \"%s\"", testErrnos[k], s);
+
+    s = svlib_dpi_imported_regexErrorString(badReErr, "(unclosed");
+    CHECK(strcmp(s, expBadReStr) == 0, "regexErrorString gave \"%s\"", s);
+
+    {
+      int32_t         matches[6];
+      int32_t         count;
+      testOpenArray_s ml = { matches, 0, 5, sizeof(int32_t) };
+      int             pad = i % 7;
+      int             idLen;
+      sprintf(subject, "%*s## tag%d_%d ##", pad, "", id, i);
+      err = svlib_dpi_imported_regexRun("([a-z]+)([0-9]+)_", subject, regexNOCASE, 0,
+                                        &count, &ml);
+      idLen = snprintf(NULL, 0, "%d", id);
+      CHECK(err == 0 && count == 3
+            && matches[0] == pad+3 && matches[1] == pad+7+idLen
+            && matches[2] == pad+3 && matches[3] == pad+6
+            && matches[4] == pad+6 && matches[5] == pad+6+idLen,
+            "regexRun on \"%s\" gave count=%d", subject, count);
+    }
+
+    if (i % GLOB_EVERY == id % GLOB_EVERY) {
+      void       *h;
+      uint32_t    number;
+      const char *names[N_FILES];
+      testOpenArray_s ss = { names, 0, N_FILES-1, sizeof(char*) };
+      err = svlib_dpi_imported_globStart(globPattern, &h, &number);
+      CHECK(err == 0 && number == N_FILES && svlib_dpi_imported_saBufCount(h) == N_FILES,
+            "glob found %u files", number);
+      if (err == 0 && number == N_FILES) {
+        if (i & 1) {
+          err = svlib_dpi_imported_saBufGetAll(h, &ss);
+          CHECK(err == 0, "saBufGetAll failed");
+          for (k = 0; k < N_FILES; k++) {
+            CHECK(strcmp(names[k], globFiles[k]) == 0, "glob[%d] is \"%s\"", k, names[k]);
+          }
+          svlib_dpi_imported_saBufFree(&h);
+          CHECK(h == NULL, "saBufFree left the handle set");
+        } else {
+          for (k = 0; h != NULL; k++) {
+            err = svlib_dpi_imported_saBufNext(&h, &s);
+            CHECK(err == 0, "saBufNext failed");
+            if (h != NULL) {
+              CHECK(k < N_FILES && strcmp(s, globFiles[k]) == 0, "glob[%d] is \"%s\"", k, s);
+            }
+          }
+          CHECK(k == N_FILES+1, "saBufNext gave %d strings", k-1);
+        }
+      }
+
+      {
+        char *product, *version;
+        err = svlib_dpi_imported_getVlogInfo(&product, &version, &h);
+        CHECK(err == 0 && svlib_dpi_imported_saBufCount(h) == N_ARGS, "getVlogInfo failed");
+        if (err == 0) {
+          const char *args[N_ARGS];
+          testOpenArray_s as = { args, 0, N_ARGS-1, sizeof(char*) };
+          (void) svlib_dpi_imported_saBufGetAll(h, &as);
+          for (k = 0; k < N_ARGS; k++) {
+            CHECK(strcmp(args[k], testArgsFlat[k]) == 0, "argv[%d] is \"%s\"", k, args[k]);
+          }
+          svlib_dpi_imported_saBufFree(&h);
+        }
+      }
+    }
+  }
+  return (void*)(intptr_t)fails;
+}
+
+/*--------------------------------------------------------------------------
+ * Set up the expected results, run the workers, tidy up
+ *--------------------------------------------------------------------------
+ */
+int main() {
+  pthread_t   threads[N_THREADS];
+  long        fails = 0;
+  int         i;
+  const char *s;
+
+  if (getcwd(expCwd, sizeof(expCwd)) == NULL) {
+    perror("getcwd");
+    return 2;
+  }
+  for (i = 0; i < N_ERRNOS; i++) {
+    snprintf(expErrStr[i], sizeof(expErrStr[i]), "%s", strerror(testErrnos[i]));
+  }
+  {
+    int32_t         matches[2];
+    int32_t         count;
+    testOpenArray_s ml = { matches, 0, 1, sizeof(int32_t) };
+    badReErr = svlib_dpi_imported_regexRun("(unclosed", "x", 0, 0, &count, &ml);
+    if (badReErr == 0) {
+      fprintf(stderr, "regexRun accepted a bad pattern\n");
+      return 2;
+    }
+    snprintf(expBadReStr, sizeof(expBadReStr), "%s",
+             svlib_dpi_imported_regexErrorString(badReErr, "(unclosed"));
+  }
+  for (i = 0; i < N_THREADS; i++) {
+    (void) svlib_dpi_imported_timeFormatST(threadEpoch(i), &s);
+    snprintf(expStardate[i], sizeof(expStardate[i]), "%s", s);
+  }
+
+  strcpy(globDir, "/tmp/svlib_dpi_mt_XXXXXX");
+  if (mkdtemp(globDir) == NULL) {
+    perror("mkdtemp");
+    return 2;
+  }
+  sprintf(globPattern, "%s/file_*.txt", globDir);
+  for (i = 0; i < N_FILES; i++) {
+    FILE *f;
+    sprintf(globFiles[i], "%s/file_%03d.txt", globDir, i);
+    f = fopen(globFiles[i], "w");
+    if (f == NULL) {
+      perror(globFiles[i]);
+      return 2;
+    }
+    fclose(f);
+  }
+
+  for (i = 0; i < N_THREADS; i++) {
+    pthread_create(&threads[i], NULL, worker, (void*)(intptr_t)i);
+  }
+  for (i = 0; i < N_THREADS; i++) {
+    void *r;
+    pthread_join(threads[i], &r);
+    fails += (long)(intptr_t)r;
+  }
+
+  for (i = 0; i < N_FILES; i++) {
+    unlink(globFiles[i]);
+  }
+  rmdir(globDir);
+
+  printf("%s: %d threads x %d iterations, %ld failures\n",
+         fails ? "FAIL" : "PASS", N_THREADS, N_ITERS, fails);
+  return fails ? 1 : 0;
+}
@@ -0,0 +1,7 @@
+/* Minimal stand-in for the simulator's veriuser.h */
+#ifndef VERIUSER_H_STUB
+#define VERIUSER_H_STUB
+
+extern void io_printf(char *fmt, ...);
+
+#endif /* VERIUSER_H_STUB */
@@ -0,0 +1,19 @@
+/* Minimal stand-in for the simulator's vpi_user.h */
+#ifndef VPI_USER_H_STUB
+#define VPI_USER_H_STUB
+
+#include <stdint.h>
+
+typedef int32_t PLI_INT32;
+typedef char    PLI_BYTE8;
+
+typedef struct t_vpi_vlog_info {
+  PLI_INT32   argc;
+  PLI_BYTE8 **argv;
+  PLI_BYTE8  *product;
+  PLI_BYTE8  *version;
+} s_vpi_vlog_info, *p_vpi_vlog_info;
+
+extern PLI_INT32 vpi_get_vlog_info(p_vpi_vlog_info vlog_info_p);
+
+#endif /* VPI_USER_H_STUB */